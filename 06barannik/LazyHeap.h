@@ -0,0 +1,108 @@
+#pragma once
+#include <algorithm>
+#include <functional>
+#include <vector>
+
+// Min-heap of (key, value) entries with lazy removal.
+// Removing an entry from the middle of a heap is expensive, so entries are only marked stale by their owner
+// and get dropped once they reach the top of the heap -- or all at once, when stale entries outnumber live ones
+// (otherwise stale entries that never reach the top would keep piling up).
+//
+// Whether an entry is stale is decided by the owner, so methods that may drop entries take
+//		is_stale(value) -> bool		tells stale entries apart
+//		on_drop(value)				is called for each dropped stale entry
+// (they are passed to methods rather than stored, so that owners capturing "this" stay movable).
+template <typename Key, typename Value>
+class LazyHeap
+{
+public:
+
+	struct Entry
+	{
+		Key		key;
+		Value	value;
+
+		// std heap functions build a max-heap, so "greater" goes first
+		bool operator<(const Entry& other) const { return key > other.key; }
+	};
+
+private:
+
+	std::vector<Entry>	_entries;
+	std::size_t			_stale = 0;
+
+public:
+
+	void push(const Key& key, const Value& value)
+	{
+		_entries.push_back({ key, value });
+		std::push_heap(_entries.begin(), _entries.end());
+	}
+
+	// For bulk loading: adds entry without keeping heap order, call make_heap() afterwards
+	void push_unordered(const Key& key, const Value& value) { _entries.push_back({ key, value }); }
+
+	// Restores heap order in linear time
+	void make_heap() { std::make_heap(_entries.begin(), _entries.end()); }
+
+	// Drops entries that satisfy given predicate(entry) no matter where they are, calling on_drop(value) for each of them
+	template <typename Predicate, typename OnDrop>
+	void remove_if(Predicate&& predicate, OnDrop&& on_drop)
+	{
+		const auto removed = std::partition(_entries.begin(), _entries.end(),
+			[&predicate](const Entry& e) { return !std::invoke(predicate, e); });
+
+		// copied out first, since on_drop might push new entries
+		std::vector<Value> dropped;
+		for (auto it = removed; it != _entries.end(); ++it)
+			dropped.push_back(it->value);
+
+		_entries.erase(removed, _entries.end());
+		make_heap();
+
+		for (const auto& value : dropped)
+			std::invoke(on_drop, value);
+	}
+
+	// Drops stale entries lying on top of the heap
+	template <typename IsStale, typename OnDrop>
+	void discard_stale(IsStale&& is_stale, OnDrop&& on_drop)
+	{
+		while (!_entries.empty() && std::invoke(is_stale, _entries.front().value))
+		{
+			const Value value = pop().value;
+			if (_stale > 0)
+				--_stale;
+			std::invoke(on_drop, value);
+		}
+	}
+
+	// Tells the heap that one of its entries has just become stale.
+	// Once stale entries outnumber live ones, all of them are dropped.
+	template <typename IsStale, typename OnDrop>
+	void mark_stale(IsStale&& is_stale, OnDrop&& on_drop)
+	{
+		if (++_stale > _entries.size() / 2)
+		{
+			remove_if([&is_stale](const Entry& e) { return std::invoke(is_stale, e.value); }, std::forward<OnDrop>(on_drop));
+			_stale = 0;
+		}
+	}
+
+	// Entry with the least key (might be stale, call discard_stale() first)
+	const Entry& top() const { return _entries.front(); }
+
+	Entry pop()
+	{
+		std::pop_heap(_entries.begin(), _entries.end());
+		const Entry entry = _entries.back();
+		_entries.pop_back();
+		return entry;
+	}
+
+	void reserve(std::size_t capacity) { _entries.reserve(capacity); }
+
+	// stale entries are counted as well
+	std::size_t size() const { return _entries.size(); }
+	bool empty() const { return _entries.empty(); }
+};
@@ -0,0 +1,45 @@
+#include "Precision.h"
+
+#ifdef _WIN32
+	#ifndef NOMINMAX
+		#define NOMINMAX
+	#endif
+	#ifndef WIN32_LEAN_AND_MEAN
+		#define WIN32_LEAN_AND_MEAN
+	#endif
+	#include <windows.h>
+	static_assert(Precision::max_cores == sizeof(DWORD_PTR) * 8);
+#else
+	#include <pthread.h>
+	#include <sched.h>
+	static_assert(Precision::max_cores <= CPU_SETSIZE);
+#endif
+
+bool Precision::apply() const
+{
+	if (core >= max_cores)
+		return false;
+
+	bool ok = true;
+#ifdef _WIN32
+	if (core >= 0)
+		ok &= SetThreadAffinityMask(GetCurrentThread(), DWORD_PTR(1) << core) != 0;
+	if (realtime_priority)
+		ok &= SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL) != 0;
+#else
+	if (core >= 0)
+	{
+		cpu_set_t cpus;
+		CPU_ZERO(&cpus);
+		CPU_SET(core, &cpus);
+		ok &= pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus) == 0;
+	}
+	if (realtime_priority)
+	{
+		sched_param param{};
+		param.sched_priority = sched_get_priority_max(SCHED_FIFO);
+		ok &= pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) == 0;
+	}
+#endif
+	return ok;
+}
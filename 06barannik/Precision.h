@@ -0,0 +1,112 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+	#include <intrin.h>		// _mm_pause()
+#endif
+
+// Settings of high-precision timers.
+// e.g., Precision{}								-- hybrid sleep/spin on any core
+//		 Precision{}.pin_to(3)						-- ... on core #3 only
+//		 Precision{}.pin_to(3).realtime()			-- ... on core #3 with real-time priority (SCHED_FIFO on Linux)
+struct Precision
+{
+	int  core				= -1;		// core to pin timer thread to; -1 means "don't pin"
+	bool realtime_priority	= false;	// usually requires elevated privileges
+
+	// affinity mask width (checked against platform headers in Precision.cpp)
+#ifdef _WIN32
+	static constexpr int max_cores = sizeof(void*) * 8;
+#else
+	static constexpr int max_cores = 1024;
+#endif
+
+	// Throws std::invalid_argument if core_idx is out of [0, max_cores)
+	Precision& pin_to(int core_idx)
+	{
+		if (core_idx < 0 || core_idx >= max_cores)
+			throw std::invalid_argument("Precision: core #" + std::to_string(core_idx) + " is out of range");
+		core = core_idx;
+		return *this;
+	}
+
+	Precision& realtime() { realtime_priority = true; return *this; }
+
+	// Applies settings to the calling thread.
+	// Returns false if any of them couldn't be applied (e.g. not enough privileges for real-time priority).
+	// (defined in Precision.cpp, so that platform headers don't leak into everything that includes Timer.h)
+	bool apply() const;
+};
+
+// Sleeps until slightly before the deadline and then busy-waits on a steady clock.
+// The "slightly before" part (slack) adapts to how late the OS scheduler actually wakes threads up:
+// it's twice the running average of oversleeping, and it jumps up immediately whenever a wake-up
+// oversleeps past the deadline.
+class PreciseSleeper
+{
+public:
+
+	using clock = std::chrono::steady_clock;
+
+	static constexpr std::chrono::nanoseconds min_slack	= std::chrono::microseconds(20);
+	static constexpr std::chrono::nanoseconds max_slack	= std::chrono::milliseconds(5);
+
+private:
+
+	// running average of oversleeping, shared by all timers (nanoseconds)
+	// races between timers only make the average a bit less accurate, so relaxed order is enough
+	static inline std::atomic<std::int64_t> _oversleep{ std::chrono::nanoseconds(std::chrono::microseconds(100)).count() };
+
+	static inline void cpu_relax()
+	{
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+		_mm_pause();
+#elif defined(__x86_64__) || defined(__i386__)
+		__builtin_ia32_pause();
+#else
+		std::this_thread::yield();
+#endif
+	}
+
+	static void adapt(std::chrono::nanoseconds oversleep, std::chrono::nanoseconds used_slack)
+	{
+		const std::int64_t average = _oversleep.load(std::memory_order_relaxed);
+		const std::int64_t updated = oversleep > used_slack
+			? oversleep.count()								// we've missed the deadline -- catch up at once
+			: average + (oversleep.count() - average) / 8;	// otherwise, decay slowly
+		_oversleep.store(updated, std::memory_order_relaxed);
+	}
+
+public:
+
+	static std::chrono::nanoseconds slack()
+	{
+		return std::clamp(std::chrono::nanoseconds(2 * _oversleep.load(std::memory_order_relaxed)), min_slack, max_slack);
+	}
+
+	static void sleep_until(clock::time_point deadline)
+	{
+		const auto used_slack	= slack();
+		const auto wake_up		= deadline - used_slack;
+		if (clock::now() < wake_up)
+		{
+			std::this_thread::sleep_until(wake_up);
+			adapt(clock::now() - wake_up, used_slack);
+		}
+
+		while (clock::now() < deadline)
+			cpu_relax();
+	}
+
+	template <typename Rep, typename Period>
+	static void sleep_for(const std::chrono::duration<Rep, Period>& duration)
+	{
+		sleep_until(clock::now() + duration);
+	}
+};
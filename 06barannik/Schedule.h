@@ -0,0 +1,441 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "LazyHeap.h"
+#include "Time.h"
+
+// Recurring wall-clock schedule described by a cron-style expression:
+//
+//		"minute hour day-of-month month day-of-week"
+//
+// Each field is either '*' or a comma-separated list of values, ranges ("9-17") and steps ("*/5", "9-17/2").
+// Day-of-week is 0-6 where 0 is Sunday (7 is accepted as Sunday as well).
+// e.g., "15 2 * * *"		fires every day at 02:15
+//		 "*/5 9-17 * * *"	fires every 5 minutes from 09:00 to 17:55
+//		 "0 12 * * 1-5"		fires at noon on working days
+//
+// Expression is compiled once into bit masks, so finding the next occurrence is a handful of bit scans
+// for the current day plus a cheap day-by-day walk over the calendar when the current day is exhausted.
+class Schedule
+{
+public:
+
+	using clock			= std::chrono::system_clock;
+	using time_point	= clock::time_point;
+
+private:
+
+	std::uint64_t _minutes		= 0;	// bits 0..59
+	std::uint32_t _hours		= 0;	// bits 0..23
+	std::uint32_t _days			= 0;	// bits 1..31
+	std::uint16_t _months		= 0;	// bits 1..12
+	std::uint8_t  _weekdays		= 0;	// bits 0..6, 0 = Sunday
+
+	// cron semantics: when both day fields are restricted, a day matches if EITHER of them matches
+	bool _any_day		= true;
+	bool _any_weekday	= true;
+
+	// if nothing has matched within that many days, nothing ever will (e.g. "0 0 31 2 *")
+	static constexpr int max_days_to_search = 8 * 366;
+
+	// index of the lowest set bit (value must not be 0)
+	static constexpr int lowest_bit(std::uint64_t value)
+	{
+		// de Bruijn multiplication: isolates the lowest bit and maps it to a unique 6-bit index
+		constexpr int table[64] =
+		{
+			 0,  1, 48,  2, 57, 49, 28,  3, 61, 58, 50, 42, 38, 29, 17,  4,
+			62, 55, 59, 36, 53, 51, 43, 22, 45, 39, 33, 30, 24, 18, 12,  5,
+			63, 47, 56, 27, 60, 41, 37, 16, 54, 35, 52, 21, 44, 32, 23, 11,
+			46, 26, 40, 15, 34, 20, 31, 10, 25, 14, 19,  9, 13,  8,  7,  6
+		};
+		return table[((value & (~value + 1)) * 0x03f79d71b4cb0a89ULL) >> 58];
+	}
+
+	// lowest set bit of mask that is >= from, or -1 if there's none
+	static constexpr int next_bit(std::uint64_t mask, int from)
+	{
+		if (from >= 64)
+			return -1;
+		const std::uint64_t rest = mask & (~std::uint64_t(0) << from);
+		return rest ? lowest_bit(rest) : -1;
+	}
+
+	static constexpr bool is_leap(int year)
+	{
+		return (year % 4 == 0 && year % 100 != 0) || year % 400 == 0;
+	}
+
+	static constexpr int days_in_month(int month, int year) // month is 1..12
+	{
+		constexpr int days[] = { 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+		return month == 2 && is_leap(year) ? 29 : days[month - 1];
+	}
+
+	// Parses a single field into a bit mask of allowed values within [low, high].
+	// Reports whether the field was a plain '*' through any.
+	static std::uint64_t parse_field(const std::string& field, int low, int high, bool& any)
+	{
+		const auto fail = [&field]()
+		{
+			throw std::invalid_argument("Schedule: malformed field \"" + field + '"');
+		};
+
+		const auto to_int = [&fail](const std::string& s)
+		{
+			// no field value has more than 2 digits, so longer numbers can't be valid (and might not fit into int)
+			if (s.empty() || s.size() > 2 || !std::all_of(s.begin(), s.end(), [](char c) { return c >= '0' && c <= '9'; }))
+				fail();
+			return std::stoi(s);
+		};
+
+		any = field == "*";
+
+		std::uint64_t mask = 0;
+		std::istringstream items(field);
+		std::string item;
+		while (std::getline(items, item, ','))
+		{
+			int step = 1;
+			const auto slash = item.find('/');
+			if (slash != std::string::npos)
+			{
+				step = to_int(item.substr(slash + 1));
+				item.erase(slash);
+			}
+
+			int first = low, last = high;
+			if (item != "*")
+			{
+				if (const auto dash = item.find('-'); dash != std::string::npos)
+				{
+					first	= to_int(item.substr(0, dash));
+					last	= to_int(item.substr(dash + 1));
+				}
+				else
+				{
+					// "5/15" means "from 5 to the end with step 15"
+					first	= to_int(item);
+					last	= slash != std::string::npos ? high : first;
+				}
+			}
+
+			if (step <= 0 || first < low || last > high || first > last)
+				fail();
+
+			for (int value = first; value <= last; value += step)
+				mask |= std::uint64_t(1) << value;
+		}
+
+		if (mask == 0)
+			fail();
+		return mask;
+	}
+
+	bool day_matches(int day, int month, int weekday) const
+	{
+		if (!(_months >> month & 1))
+			return false;
+
+		const bool by_day		= _days >> day & 1;
+		const bool by_weekday	= _weekdays >> weekday & 1;
+
+		if (_any_day && _any_weekday)	return true;
+		if (_any_day)					return by_weekday;
+		if (_any_weekday)				return by_day;
+		return by_day || by_weekday;
+	}
+
+	bool time_matches(int hour, int minute) const
+	{
+		return (_hours >> hour & 1) && (_minutes >> minute & 1);
+	}
+
+	// Whether daylight saving time ends later on the same day as given local time,
+	// i.e. whether some of the day's local times are yet to happen twice.
+	static bool dst_ends_later_today(const struct tm& local)
+	{
+		if (local.tm_isdst <= 0)
+			return false;
+
+		struct tm day_end = local;
+		day_end.tm_hour		= 23;
+		day_end.tm_min		= 59;
+		day_end.tm_sec		= 0;
+		day_end.tm_isdst	= -1;
+		(void)mktime(&day_end);
+		return day_end.tm_isdst == 0;
+	}
+
+	// first matching minute of the day that is not earlier than (hour, minute); -1 if the day is exhausted
+	int next_minute_of_day(int hour, int minute) const
+	{
+		if (_hours >> hour & 1)
+			if (const int m = next_bit(_minutes, minute); m >= 0)
+				return hour * 60 + m;
+
+		const int h = next_bit(_hours, hour + 1);
+		return h >= 0 ? h * 60 + lowest_bit(_minutes) : -1;
+	}
+
+public:
+
+	// Compiles given cron-style expression.
+	// Throws std::invalid_argument if expression is malformed.
+	explicit Schedule(const std::string& expression)
+	{
+		std::istringstream stream(expression);
+		std::string fields[5];
+		for (auto& field : fields)
+			if (!(stream >> field))
+				throw std::invalid_argument("Schedule: expected 5 fields in \"" + expression + '"');
+
+		std::string extra;
+		if (stream >> extra)
+			throw std::invalid_argument("Schedule: expected 5 fields in \"" + expression + '"');
+
+		bool any; // only matters for day fields
+		_minutes	= parse_field(fields[0], 0, 59, any);
+		_hours		= static_cast<std::uint32_t>(parse_field(fields[1], 0, 23, any));
+		_days		= static_cast<std::uint32_t>(parse_field(fields[2], 1, 31, _any_day));
+		_months		= static_cast<std::uint16_t>(parse_field(fields[3], 1, 12, any));
+
+		const auto weekdays = parse_field(fields[4], 0, 7, _any_weekday);
+		_weekdays	= static_cast<std::uint8_t>((weekdays | weekdays >> 7) & 0x7f); // 7 is Sunday too
+	}
+
+	// Schedule that fires every day at given local time (seconds are ignored)
+	template <typename L, typename H>
+	static Schedule daily_at(const Time<L, H>& time)
+	{
+		const DefaultTime t(time);
+		return Schedule(std::to_string(t.template get<std::chrono::minutes>().count()) + ' ' +
+						std::to_string(t.template get<std::chrono::hours>().count()) + " * * *");
+	}
+
+	// Returns the first occurrence strictly after given moment
+	// or time_point::max() if schedule can never fire (e.g. "0 0 30 2 *").
+	// Local times that happen twice when daylight saving time ends fire twice;
+	// local times skipped when it starts are shifted forward by mktime (e.g. 02:30 fires at 03:30).
+	time_point next(time_point after) const
+	{
+		// occurrences are whole minutes, so start with the next whole minute
+		const auto after_t = clock::to_time_t(after);
+		struct tm local;
+		(void)localtime_s(&local, &after_t);
+
+		int year	= local.tm_year + 1900;
+		int month	= local.tm_mon + 1;
+		int day		= local.tm_mday;
+		int weekday	= local.tm_wday;
+		int minute_of_day = local.tm_hour * 60 + local.tm_min + 1;
+
+		// Local times repeat when daylight saving time ends, so walking over them in local order
+		// would skip the repeated ones. On such a day, walk over real minutes instead until the day ends.
+		if (day_matches(day, month, weekday) && dst_ends_later_today(local))
+		{
+			auto t = after_t - local.tm_sec + 60;
+			for (struct tm current; localtime_s(&current, &t), current.tm_mday == day; t += 60)
+				if (time_matches(current.tm_hour, current.tm_min))
+					return clock::from_time_t(t);
+
+			minute_of_day = 24 * 60; // nothing has matched today
+		}
+
+		for (int searched = 0; searched < max_days_to_search; ++searched)
+		{
+			if (!(_months >> month & 1))
+			{
+				// skip the whole month at once
+				weekday = (weekday + days_in_month(month, year) - day + 1) % 7;
+				day = 1;
+				minute_of_day = 0;
+				if (++month > 12) { month = 1; ++year; }
+				continue;
+			}
+
+			if (minute_of_day < 24 * 60 && day_matches(day, month, weekday))
+			{
+				if (const int found = next_minute_of_day(minute_of_day / 60, minute_of_day % 60); found >= 0)
+				{
+					struct tm candidate = {};
+					candidate.tm_year	= year - 1900;
+					candidate.tm_mon	= month - 1;
+					candidate.tm_mday	= day;
+					candidate.tm_hour	= found / 60;
+					candidate.tm_min	= found % 60;
+					candidate.tm_isdst	= -1; // let mktime figure out daylight saving time
+
+					const auto result = clock::from_time_t(mktime(&candidate));
+					if (result > after)
+						return result;
+
+					// shouldn't happen (repeated local times are handled above), but never return the past
+					minute_of_day = found + 1;
+					continue;
+				}
+			}
+
+			// go to the next day
+			weekday = (weekday + 1) % 7;
+			minute_of_day = 0;
+			if (++day > days_in_month(month, year))
+			{
+				day = 1;
+				if (++month > 12) { month = 1; ++year; }
+			}
+		}
+
+		return time_point::max();
+	}
+};
+
+
+// Keeps a set of recurring schedules ordered by their next fire time.
+// Only schedules that are due get their next occurrence recomputed,
+// so the cost of fire_due() depends on the number of fired schedules, not on the total number of them.
+template <typename Callback = std::function<void()>>
+class ScheduleIndex
+{
+public:
+
+	using id_t			= std::size_t;
+	using clock			= Schedule::clock;
+	using time_point	= Schedule::time_point;
+
+private:
+
+	struct Entry
+	{
+		Schedule	schedule;
+		Callback	callback;
+		bool		active;
+		bool		queued;		// has an entry in the heap
+		bool		firing;		// its callback is being invoked right now
+	};
+
+	std::vector<Entry>				_entries;
+	LazyHeap<time_point, id_t>		_pending;	// by fire time
+	std::vector<id_t>				_free;		// ids of removed entries that can be reused
+	std::size_t						_active = 0;
+
+	// frees removed entry once nothing refers to it anymore
+	void release(id_t id)
+	{
+		Entry& entry = _entries[id];
+		if (entry.active || entry.queued || entry.firing)
+			return;
+		entry.callback = Callback{};
+		_free.push_back(id);
+	}
+
+	bool is_removed(id_t id) const { return !_entries[id].active; }
+
+	// called for each heap entry of a removed schedule once it's dropped from the heap
+	void on_dropped(id_t id)
+	{
+		_entries[id].queued = false;
+		release(id);
+	}
+
+	void discard_removed()
+	{
+		_pending.discard_stale([this](id_t i) { return is_removed(i); }, [this](id_t i) { on_dropped(i); });
+	}
+
+	void push(time_point at, id_t id)
+	{
+		if (at == time_point::max())
+			return; // will never fire
+		_pending.push(at, id);
+		_entries[id].queued = true;
+	}
+
+public:
+
+	// Adds schedule to the index. Its first occurrence is looked for after given moment.
+	// Returns id that can be used to remove the schedule later.
+	// Ids of removed schedules get reused.
+	id_t add(Schedule schedule, Callback callback, time_point from = clock::now())
+	{
+		const auto at = schedule.next(from);
+
+		id_t id;
+		if (!_free.empty())
+		{
+			id = _free.back();
+			_free.pop_back();
+			_entries[id] = { std::move(schedule), std::move(callback), true, false, false };
+		}
+		else
+		{
+			id = _entries.size();
+			_entries.push_back({ std::move(schedule), std::move(callback), true, false, false });
+		}
+
+		++_active;
+		push(at, id);
+		return id;
+	}
+
+	// Removes schedule from the index. Its pending occurrence is discarded lazily.
+	// Can be called from a callback, including the callback of the schedule being removed.
+	void remove(id_t id)
+	{
+		if (id < _entries.size() && _entries[id].active)
+		{
+			_entries[id].active = false;
+			--_active;
+			release(id); // only frees it right away if it has no heap entry
+			if (_entries[id].queued)
+				_pending.mark_stale([this](id_t i) { return is_removed(i); }, [this](id_t i) { on_dropped(i); });
+		}
+	}
+
+	// Returns the closest fire time or time_point::max() if there's nothing to fire
+	time_point next_fire()
+	{
+		discard_removed();
+		return _pending.empty() ? time_point::max() : _pending.top().key;
+	}
+
+	// Invokes callbacks of all schedules that are due at given moment (in order of their fire times)
+	// and reschedules them to their next occurrence.
+	// Callbacks may add and remove schedules (their own ones included).
+	// Returns number of invoked callbacks.
+	std::size_t fire_due(time_point current = clock::now())
+	{
+		std::size_t fired = 0;
+		for (discard_removed(); !_pending.empty() && _pending.top().key <= current; discard_removed())
+		{
+			const auto [at, id] = _pending.pop();
+			_entries[id].queued = false;
+
+			// occurrences missed while nobody was calling fire_due() are collapsed into a single one
+			push(_entries[id].schedule.next(std::max(at, current)), id);
+
+			// callback is moved out for the time of the call: it may add schedules (which moves entries around)
+			// or remove its own schedule (which would destroy it while it's still running)
+			_entries[id].firing = true;
+			Callback callback = std::move(_entries[id].callback);
+			std::invoke(callback);
+
+			Entry& entry = _entries[id];
+			entry.firing = false;
+			if (entry.active)
+				entry.callback = std::move(callback);
+			else
+				release(id);
+			++fired;
+		}
+		return fired;
+	}
+
+	std::size_t size() const { return _active; }
+	bool empty() const { return _active == 0; }
+};
@@ -1,6 +1,12 @@
 #pragma once
+#include <atomic>
+#include <future>
+#include <memory>
+#include <stdexcept>
 #include <thread>
+#include <tuple>
 #include "Time.h"
+#include "Precision.h"
 
 // Timer that has a duration of type Duration.
 // Starts immediately after its creation.
@@ -10,11 +16,14 @@ class Timer
 private:
 
 	std::thread _thread;
-	bool _elapsed = false;
+
+	// shared with the timer's thread, which may outlive the Timer object itself
+	std::shared_ptr<std::atomic<bool>> _elapsed = std::make_shared<std::atomic<bool>>(false);
 
 public:
 
-	template<typename L, typename H, typename Functor, typename... Args>
+	template<typename L, typename H, typename Functor, typename... Args,
+			 typename = std::enable_if_t<!std::is_same_v<std::decay_t<Functor>, Precision>>>
 	explicit Timer(Time<L, H>&& time, const bool sync, Functor&& fn, Args&&... args)
 	{
 		const Duration duration = static_cast<Duration>(time);
@@ -28,17 +37,61 @@ public:
 			// We're passing duration by value because duration is a local variable.
 			// Thread might start its execution after we left the constructor.
 			// Thus, we might get a reference to destroyed object :(
-			_thread = std::thread([this, duration, &fn, &args...]	
+			_thread = std::thread([elapsed = _elapsed, duration, &fn, &args...]	
 				{
 					std::this_thread::sleep_for(duration);
 					std::invoke(fn, std::forward<decltype(args)>(args)...);
-					_elapsed = true;
+					*elapsed = true;
 				});
 			_thread.detach();
 		}
 	}
 
-	bool elapsed() const { return _elapsed; }
+	// High-precision timer: sleeps until slightly before the deadline and busy-waits the rest of the time.
+	// Asynchronous timer's thread gets given precision settings applied (pinning, real-time priority).
+	// Synchronous timer spins on the calling thread, which it doesn't reconfigure,
+	// so it throws std::invalid_argument if given any settings besides Precision{}.
+	// Throws std::runtime_error if settings couldn't be applied (e.g. no privileges for real-time priority);
+	// in that case the timer doesn't fire.
+	template<typename L, typename H, typename Functor, typename... Args>
+	explicit Timer(Time<L, H>&& time, const bool sync, const Precision& precision, Functor&& fn, Args&&... args)
+	{
+		// deadline is fixed right away, so the time it takes to start a thread doesn't make us late
+		const auto deadline = PreciseSleeper::clock::now() + static_cast<Duration>(time);
+		if (sync)
+		{
+			if (precision.core >= 0 || precision.realtime_priority)
+				throw std::invalid_argument("Timer: synchronous timer cannot be pinned or given real-time priority");
+			PreciseSleeper::sleep_until(deadline);
+			std::invoke(fn, std::forward<Args>(args)...);
+		}
+		else
+		{
+			std::promise<bool> applied;
+			auto applied_result = applied.get_future();
+
+			// callable and its arguments are copied into the thread, since it may outlive them (and this Timer)
+			_thread = std::thread([elapsed = _elapsed, deadline, precision, applied = std::move(applied),
+								   fn = std::decay_t<Functor>(std::forward<Functor>(fn)),
+								   args = std::make_tuple(std::forward<Args>(args)...)]() mutable
+				{
+					const bool ok = precision.apply();
+					applied.set_value(ok);
+					if (!ok)
+						return;
+
+					PreciseSleeper::sleep_until(deadline);
+					std::apply(fn, std::move(args));
+					*elapsed = true;
+				});
+			_thread.detach();
+
+			if (!applied_result.get())
+				throw std::runtime_error("Timer: cannot apply precision settings (core pinning or real-time priority)");
+		}
+	}
+
+	bool elapsed() const { return *_elapsed; }
 };
 
 template<typename L, typename H, typename Functor, typename... Args>
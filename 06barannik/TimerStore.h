@@ -0,0 +1,531 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+#include "LazyHeap.h"
+
+#ifdef _WIN32
+	#ifndef NOMINMAX
+		#define NOMINMAX
+	#endif
+	#ifndef WIN32_LEAN_AND_MEAN
+		#define WIN32_LEAN_AND_MEAN
+	#endif
+	#include <windows.h>
+#else
+	#include <fcntl.h>
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <unistd.h>
+#endif
+
+// File mapped into memory as a whole. Can be grown (which remaps it, so pointers to its data get invalidated).
+class MappedFile
+{
+private:
+
+	void*		_data		= nullptr;
+	std::size_t	_size		= 0;
+	bool		_created	= false;
+
+#ifdef _WIN32
+	HANDLE _file	= INVALID_HANDLE_VALUE;
+	HANDLE _mapping	= nullptr;
+#else
+	int _file = -1;
+#endif
+
+	[[noreturn]] static void fail(const std::string& what)
+	{
+		throw std::runtime_error("MappedFile: " + what);
+	}
+
+	// Maps first size bytes of the file, extending the file if it's shorter than that.
+	// Current mapping (if any) is released only once the new one is in place, so it stays valid if this throws.
+	void map(std::size_t size)
+	{
+#ifdef _WIN32
+		// mapping object extends the file to the requested size on its own
+		const HANDLE mapping = CreateFileMappingA(_file, nullptr, PAGE_READWRITE,
+												  static_cast<DWORD>(std::uint64_t(size) >> 32), static_cast<DWORD>(size), nullptr);
+		if (!mapping)
+			fail("cannot create file mapping");
+		void* const data = MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, size);
+		if (!data)
+		{
+			CloseHandle(mapping);
+			fail("cannot map file");
+		}
+		unmap();
+		_mapping = mapping;
+#else
+		struct stat info;
+		if (::fstat(_file, &info) != 0)
+			fail("cannot get size of file");
+		if (static_cast<std::size_t>(info.st_size) < size && ::ftruncate(_file, static_cast<off_t>(size)) != 0)
+			fail("cannot resize file");
+		void* const data = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, _file, 0);
+		if (data == MAP_FAILED)
+			fail("cannot map file");
+		unmap();
+#endif
+		_data = data;
+		_size = size;
+	}
+
+	void unmap()
+	{
+#ifdef _WIN32
+		if (_data)		UnmapViewOfFile(_data);
+		if (_mapping)	CloseHandle(_mapping);
+		_mapping = nullptr;
+#else
+		if (_data)		::munmap(_data, _size);
+#endif
+		_data = nullptr;
+		_size = 0;
+	}
+
+	void open(const std::string& path, std::size_t initial_size)
+	{
+		std::size_t size = 0;
+#ifdef _WIN32
+		_file = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (_file == INVALID_HANDLE_VALUE)
+			fail("cannot open " + path);
+		LARGE_INTEGER file_size;
+		if (!GetFileSizeEx(_file, &file_size))
+			fail("cannot get size of " + path);
+		size = static_cast<std::size_t>(file_size.QuadPart);
+#else
+		_file = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+		if (_file < 0)
+			fail("cannot open " + path);
+		struct stat info;
+		if (::fstat(_file, &info) != 0)
+			fail("cannot get size of " + path);
+		size = static_cast<std::size_t>(info.st_size);
+#endif
+		_created = size == 0;
+		map(_created ? initial_size : size);
+	}
+
+	void close()
+	{
+		unmap();
+#ifdef _WIN32
+		if (_file != INVALID_HANDLE_VALUE)	CloseHandle(_file);
+		_file = INVALID_HANDLE_VALUE;
+#else
+		if (_file >= 0)						::close(_file);
+		_file = -1;
+#endif
+	}
+
+public:
+
+	// Opens (or creates) file at given path and maps it as it is.
+	// Empty file (e.g. a just created one) is extended with zeros to initial_size first.
+	MappedFile(const std::string& path, std::size_t initial_size)
+	{
+		try
+		{
+			open(path, initial_size);
+		}
+		catch (...)
+		{
+			close();	// destructor isn't called for a partially constructed object
+			throw;
+		}
+	}
+
+	~MappedFile() { close(); }
+
+	MappedFile(const MappedFile&)				= delete;
+	MappedFile& operator=(const MappedFile&)	= delete;
+
+	// Remaps the file with a bigger size.
+	// Throws std::runtime_error on failure, keeping the current mapping (the file itself might be extended already).
+	void grow(std::size_t size)
+	{
+		if (size > _size)
+			map(size);
+	}
+
+	// Asks OS to write dirty pages to disk.
+	// Not needed to survive a crash of the process (OS keeps dirty pages anyway), only to survive a crash of the OS;
+	// pages are written in no particular order, so only what was flushed is guaranteed to be consistent.
+	void flush()
+	{
+#ifdef _WIN32
+		FlushViewOfFile(_data, 0);
+		FlushFileBuffers(_file);
+#else
+		::msync(_data, _size, MS_SYNC);
+#endif
+	}
+
+	// whether the file was empty when it got opened
+	bool		created() const	{ return _created; }
+
+	void*		data()			{ return _data; }
+	const void*	data() const	{ return _data; }
+	std::size_t	size() const	{ return _size; }
+};
+
+
+// Persistent set of pending timers kept in a memory-mapped file.
+// Each timer is a fixed-size record (absolute deadline, callback id, payload),
+// so adding a timer is writing a record into a free slot or appending it to the end of the file,
+// and removing a timer is marking its slot as free.
+//
+// Deadlines are wall-clock (system_clock) time points, since steady_clock ones don't survive a restart.
+// Payload must be trivially copyable, since it's stored as raw bytes.
+template <typename Payload = std::uint64_t>
+class TimerStore
+{
+public:
+
+	static_assert(std::is_trivially_copyable_v<Payload>, "Payload is stored as raw bytes, so it has to be trivially copyable");
+
+	using id_t			= std::uint64_t;
+	using clock			= std::chrono::system_clock;
+	using time_point	= clock::time_point;
+
+	struct Record
+	{
+		std::int64_t	deadline;		// nanoseconds since epoch
+		std::uint64_t	callback_id;
+		std::uint64_t	alive;			// 0 means that slot is free
+		Payload			payload;
+
+		time_point at() const
+		{
+			return time_point(std::chrono::duration_cast<clock::duration>(std::chrono::nanoseconds(deadline)));
+		}
+	};
+
+private:
+
+	static constexpr char			signature[8]	= { 'V', 'T', 'I', 'M', 'E', 'R', 'S', '\0' };
+	static constexpr std::uint32_t	version			= 1;
+
+	struct alignas(64) Header
+	{
+		char			magic[8];
+		std::uint32_t	version;
+		std::uint32_t	record_size;
+		std::uint64_t	capacity;	// number of slots the file has room for
+		std::uint64_t	used;		// number of slots ever written (free ones included)
+	};
+
+	static_assert(alignof(Record) <= alignof(Header), "Records are placed right after the header");
+
+	MappedFile			_file;
+	std::vector<id_t>	_free;	// free slots below header().used
+	std::size_t			_alive = 0;
+
+	Header&			header()		{ return *static_cast<Header*>(_file.data()); }
+	const Header&	header() const	{ return *static_cast<const Header*>(_file.data()); }
+
+	Record*			records()		{ return reinterpret_cast<Record*>(static_cast<char*>(_file.data()) + sizeof(Header)); }
+	const Record*	records() const	{ return reinterpret_cast<const Record*>(static_cast<const char*>(_file.data()) + sizeof(Header)); }
+
+	static constexpr std::size_t file_size(std::uint64_t capacity)
+	{
+		return sizeof(Header) + static_cast<std::size_t>(capacity) * sizeof(Record);
+	}
+
+public:
+
+	// Opens existing store or creates a new one at given path.
+	// Existing store is grown to initial_capacity if it's smaller than that.
+	// Throws std::runtime_error if file can't be mapped, isn't a timer store or is damaged (e.g. truncated).
+	explicit TimerStore(const std::string& path, std::uint64_t initial_capacity = 1024) :
+		TimerStore(path, initial_capacity, [](id_t, const Record&) {}) {}
+
+	// Same as above, but also calls on_load(id, record) for each stored timer
+	// within the same pass over the file that looks for free slots.
+	template <typename Callable>
+	TimerStore(const std::string& path, std::uint64_t initial_capacity, Callable&& on_load) :
+		_file(path, file_size(std::max<std::uint64_t>(initial_capacity, 1)))
+	{
+		const auto incompatible = [&path]()
+		{
+			throw std::runtime_error("TimerStore: " + path + " is not a compatible timer store");
+		};
+
+		if (_file.created())
+		{
+			Header& h = header();
+			std::memcpy(h.magic, signature, sizeof(signature));
+			h.version		= version;
+			h.record_size	= sizeof(Record);
+			h.capacity		= (_file.size() - sizeof(Header)) / sizeof(Record);
+			h.used			= 0;
+		}
+		else
+		{
+			// everything is checked before the file gets resized or written to
+			if (_file.size() < sizeof(Header))
+				incompatible();
+
+			const Header& h = header();
+			if (std::memcmp(h.magic, signature, sizeof(signature)) != 0 || h.version != version || h.record_size != sizeof(Record))
+				incompatible();
+			if (h.used > h.capacity || h.capacity > (_file.size() - sizeof(Header)) / sizeof(Record))
+				incompatible();
+
+			if (initial_capacity > h.capacity)
+			{
+				_file.grow(file_size(initial_capacity));
+				header().capacity = initial_capacity;
+			}
+		}
+
+		const Header& h = header();
+		// one pass over the slots to find out which of them are free
+		const Record* r = records();
+		for (id_t id = 0; id < h.used; ++id)
+		{
+			if (r[id].alive)
+			{
+				++_alive;
+				std::invoke(on_load, id, r[id]);
+			}
+			else
+			{
+				_free.push_back(id);
+			}
+		}
+		// reuse lower slots first, so the file stays dense
+		std::reverse(_free.begin(), _free.end());
+	}
+
+	// Stores a timer. Returned id stays the same after restart.
+	id_t add(time_point deadline, std::uint64_t callback_id, const Payload& payload)
+	{
+		id_t id;
+		if (!_free.empty())
+		{
+			id = _free.back();
+			_free.pop_back();
+		}
+		else
+		{
+			if (header().used == header().capacity)
+			{
+				const std::uint64_t capacity = header().capacity * 2;
+				_file.grow(file_size(capacity));
+				header().capacity = capacity;
+			}
+			id = header().used;
+		}
+
+		Record& r		= records()[id];
+		r.deadline		= std::chrono::duration_cast<std::chrono::nanoseconds>(deadline.time_since_epoch()).count();
+		r.callback_id	= callback_id;
+		r.payload		= payload;
+
+		// keeps the alive mark from being written ahead of the record's fields, which only matters
+		// if this process dies in the middle of add(). It doesn't order how the OS writes dirty pages back,
+		// so after an OS crash or power loss a record may be torn even if it's marked alive.
+		std::atomic_thread_fence(std::memory_order_release);
+		r.alive = 1;
+		if (id == header().used)
+			++header().used;
+
+		++_alive;
+		return id;
+	}
+
+	void remove(id_t id)
+	{
+		if (id < header().used && records()[id].alive)
+		{
+			records()[id].alive = 0;
+			_free.push_back(id);
+			--_alive;
+		}
+	}
+
+	const Record& get(id_t id) const { return records()[id]; }
+
+	// number of slots ever written; ids of stored timers are below it
+	std::uint64_t slots_used() const { return header().used; }
+
+	// Calls f(id, record) for each stored timer
+	template <typename Callable>
+	void for_each(Callable&& f) const
+	{
+		const Record* r = records();
+		for (id_t id = 0, used = header().used; id < used; ++id)
+			if (r[id].alive)
+				std::invoke(f, id, r[id]);
+	}
+
+	void flush() { _file.flush(); }
+
+	std::size_t size() const { return _alive; }
+	bool empty() const { return _alive == 0; }
+};
+
+
+// What to do on startup with stored timers whose deadlines have passed while the process was down
+enum class MissedPolicy
+{
+	fire,			// fire them as soon as possible
+	fire_if_recent,	// fire the ones that are late by no more than the grace period, discard the rest
+	discard			// don't fire them at all
+};
+
+
+// Single-shot timers that survive restarts of the process.
+// On construction all stored timers are loaded from the TimerStore file in one pass and armed at once
+// (heap is built in linear time rather than by inserting timers one by one).
+// Callbacks themselves can't be stored, so they are identified by callback id and dispatched through
+// a single user-supplied function: dispatch(callback_id, payload).
+//
+// NB! There's no thread of its own here (unlike Timer and Watch): "armed" means that timers are ordered
+// by their deadlines, and they fire only when the owner calls fire_due(), e.g. from its event loop
+// or from a thread that sleeps until next_fire().
+// It isn't a persistent backend of Timer/Watch either, since those take arbitrary callables that can't be stored.
+template <typename Payload = std::uint64_t>
+class PersistentTimers
+{
+public:
+
+	using store_t		= TimerStore<Payload>;
+	using id_t			= typename store_t::id_t;
+	using clock			= typename store_t::clock;
+	using time_point	= typename store_t::time_point;
+	using dispatcher_t	= std::function<void(std::uint64_t, const Payload&)>;
+
+private:
+
+	struct Slot
+	{
+		id_t			id;
+		std::uint32_t	generation;	// generation of the slot at the moment the timer was armed
+	};
+
+	LazyHeap<std::int64_t, Slot>	_pending;		// by deadline (same as in the stored record)
+	std::vector<std::uint32_t>		_generations;	// bumped every time a slot is freed, since freed slots get reused
+	store_t							_store;			// declared after _pending, since it fills _pending while loading
+	dispatcher_t					_dispatch;
+
+	static std::int64_t to_ns(time_point at)
+	{
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(at.time_since_epoch()).count();
+	}
+
+	std::uint32_t& generation(id_t id)
+	{
+		if (id >= _generations.size())
+			_generations.resize(static_cast<std::size_t>(id) + 1, 0);
+		return _generations[id];
+	}
+
+	// heap entry refers to a timer that has been removed (its slot might already hold another timer)
+	bool is_stale(const Slot& slot)
+	{
+		return slot.generation != generation(slot.id);
+	}
+
+	// frees the slot; entries pointing to it become stale
+	void release(id_t id)
+	{
+		++generation(id);
+		_store.remove(id);
+	}
+
+	void discard_removed()
+	{
+		_pending.discard_stale([this](const Slot& slot) { return is_stale(slot); }, [](const Slot&) {});
+	}
+
+public:
+
+	// initial_capacity is the number of timers the store file is sized for up front,
+	// so filling it doesn't remap the file over and over.
+	PersistentTimers(const std::string& path, dispatcher_t dispatch,
+					 std::uint64_t initial_capacity = 1024,
+					 MissedPolicy policy = MissedPolicy::fire,
+					 std::chrono::nanoseconds grace = std::chrono::seconds(0),
+					 time_point current = clock::now()) :
+		_store(path, initial_capacity, [this](id_t id, const typename store_t::Record& r) { _pending.push_unordered(r.deadline, { id, 0 }); }),
+		_dispatch(std::move(dispatch))
+	{
+		if (policy != MissedPolicy::fire)
+		{
+			// oldest deadline still worth firing
+			const std::int64_t oldest = policy == MissedPolicy::discard ? to_ns(current) : to_ns(current) - grace.count();
+
+			using entry_t = typename LazyHeap<std::int64_t, Slot>::Entry;
+			_pending.remove_if([oldest](const entry_t& e) { return e.key < oldest; },
+							   [this](const Slot& slot) { release(slot.id); });
+		}
+
+		_pending.make_heap();
+	}
+
+	// Arms a timer and stores it. Returned id stays the same after restart.
+	id_t add(time_point deadline, std::uint64_t callback_id, const Payload& payload = Payload{})
+	{
+		const id_t id = _store.add(deadline, callback_id, payload);
+		_pending.push(to_ns(deadline), { id, generation(id) });
+		return id;
+	}
+
+	// Disarms a timer. Its heap entry is discarded lazily.
+	void remove(id_t id)
+	{
+		if (id >= _store.slots_used() || !_store.get(id).alive)
+			return;
+
+		release(id);
+		_pending.mark_stale([this](const Slot& slot) { return is_stale(slot); }, [](const Slot&) {});
+	}
+
+	// Returns the closest deadline or time_point::max() if there's nothing to fire
+	time_point next_fire()
+	{
+		discard_removed();
+		return _pending.empty()
+			? time_point::max()
+			: time_point(std::chrono::duration_cast<typename clock::duration>(std::chrono::nanoseconds(_pending.top().key)));
+	}
+
+	// Fires all timers that are due at given moment (in order of their deadlines) and removes them from the store.
+	// Returns number of fired timers.
+	std::size_t fire_due(time_point current = clock::now())
+	{
+		const std::int64_t now_ns = to_ns(current);
+
+		std::size_t fired = 0;
+		for (discard_removed(); !_pending.empty() && _pending.top().key <= now_ns; discard_removed())
+		{
+			const id_t id = _pending.pop().value.id;
+
+			// copy it out, since dispatch might add timers and thus remap the file
+			const auto record = _store.get(id);
+			release(id);
+
+			_dispatch(record.callback_id, record.payload);
+			++fired;
+		}
+		return fired;
+	}
+
+	void flush() { _store.flush(); }
+
+	std::size_t size() const { return _store.size(); }
+	bool empty() const { return _store.empty(); }
+};
@@ -1,5 +1,6 @@
 #pragma once
 #include "Timer.h"
+#include "Schedule.h"
 
 // Watch that has a duration of type Duration.
 // Starts immediately after its creation.
@@ -10,11 +11,40 @@ private:
 
 	Timer<Duration> _timer;
 
+	// Time left until given local time.
+	// If that time has already passed today, it's the time left until it happens tomorrow.
+	template <typename L, typename H>
+	static auto until(const Time<L, H>& time)
+	{
+		auto remaining = time - now();
+		if (static_cast<std::chrono::nanoseconds>(remaining) < std::chrono::nanoseconds::zero())
+			remaining = remaining + Time<std::chrono::hours>{ std::chrono::hours(24) };
+		return remaining;
+	}
+
+	// Time left until the next occurrence of given schedule
+	static Time<Duration> until(const Schedule& schedule)
+	{
+		const auto current	= Schedule::clock::now();
+		const auto next		= schedule.next(current);
+		if (next == Schedule::time_point::max())
+			throw std::invalid_argument("Watch: schedule never fires");
+		return { std::chrono::ceil<Duration>(next - current) };
+	}
+
 public:
 
 	template<typename L, typename H, typename Functor, typename... Args>
 	explicit Watch(Time<L, H>&& time, const bool sync, Functor&& fn, Args&&... args) :
-		_timer(std::forward<Time<L, H>>(time - now()), sync,
+		_timer(until(time), sync,
+			   std::forward<decltype(fn)>(fn), std::forward<decltype(args)>(args)...) {}
+
+	// Fires once, at the next occurrence of given schedule.
+	// Use ScheduleIndex to keep firing on every occurrence.
+	// Throws std::invalid_argument if schedule never fires (e.g. "0 0 31 2 *").
+	template<typename Functor, typename... Args>
+	explicit Watch(const Schedule& schedule, const bool sync, Functor&& fn, Args&&... args) :
+		_timer(until(schedule), sync,
 			   std::forward<decltype(fn)>(fn), std::forward<decltype(args)>(args)...) {}
 
 	bool elapsed() const { return _timer.elapsed(); }
@@ -8,10 +8,16 @@
 //				
 // P.S.			Time class is the most interesting one :)
 
+#include <algorithm>
+#include <filesystem>
 #include <iostream>
+#include <vector>
 #include "Time.h"
 #include "Timer.h"
 #include "Watch.h"
+#include "Schedule.h"
+#include "Precision.h"
+#include "TimerStore.h"
 using namespace std::literals::chrono_literals;
 using namespace std::chrono;
 using std::cout;
@@ -121,6 +127,175 @@ namespace tests
 			cout << "is watch1 elapsed? " << watch1.elapsed() << nendl;
 		}
 	}
+
+	namespace schedule
+	{
+		void run()
+		{
+			std::cout << nendl << "--------------Testing Schedule class--------------" << nendl;
+
+			const auto print = [](const char* name, Schedule::time_point at)
+			{
+				const auto at_t = Schedule::clock::to_time_t(at);
+				struct tm local;
+				(void)localtime_s(&local, &at_t);
+				cout << name << "\t" << Time{ seconds(local.tm_sec), minutes(local.tm_min), hours(local.tm_hour) }
+					 << " day " << local.tm_mday << '.' << local.tm_mon + 1 << nendl;
+			};
+
+			const auto current = Schedule::clock::now();
+			const Schedule daily("15 2 * * *");
+			const Schedule working_hours("*/5 9-17 * * *");
+			const Schedule leap_day("0 12 29 2 *");
+			const Schedule tomorrow = Schedule::daily_at(now() - Time{ 1min });
+
+			print("next \"15 2 * * *\":\t", daily.next(current));
+			print("next \"*/5 9-17 * * *\":", working_hours.next(current));
+			print("next \"0 12 29 2 *\":\t", leap_day.next(current));
+			print("daily_at(now() - 1min):", tomorrow.next(current));
+
+			// every 20 minutes of real time for a year, daylight saving time transitions included
+			// (in time zones that have them: the hour repeated when it ends fires twice)
+			const Schedule every_20min("*/20 * * * *");
+			std::size_t wrong_gaps = 0;
+			for (auto [t, i] = std::pair{ every_20min.next(current), 0 }; i < 365 * 24 * 3; ++i)
+			{
+				const auto following = every_20min.next(t);
+				wrong_gaps += following - t != 20min;
+				t = following;
+			}
+			cout << "\"*/20 * * * *\" gaps other than 20min within a year: " << wrong_gaps << nendl;
+
+			try
+			{
+				Schedule wrong("61 * * * *");
+			}
+			catch (const std::invalid_argument& e)
+			{
+				cout << "Schedule(\"61 * * * *\") throws: " << e.what() << nendl;
+			}
+
+			try
+			{
+				Watch<seconds>		never(Schedule("0 0 31 2 *"),	true,	[]() {});
+			}
+			catch (const std::invalid_argument& e)
+			{
+				cout << "Watch(Schedule(\"0 0 31 2 *\")) throws: " << e.what() << nendl;
+			}
+
+			// 10'000 schedules firing every minute, but only the ones that are due are touched
+			ScheduleIndex<> index;
+			std::size_t calls = 0;
+			for (int i = 0; i < 10'000; ++i)
+				index.add(Schedule(i % 2 ? "* * * * *" : "15 2 * * *"), [&calls]() { ++calls; }, current);
+
+			const auto in_a_minute = current + 1min;
+			cout << "schedules in index:\t" << index.size() << nendl;
+			cout << "fired by now:\t\t" << index.fire_due(current) << nendl;
+			cout << "fired in a minute:\t" << index.fire_due(in_a_minute) << nendl;
+			cout << "fired again:\t\t" << index.fire_due(in_a_minute) << " (calls so far: " << calls << ")" << nendl;
+
+			// fires once, at the beginning of the next minute
+			// (it's sync, so that nothing is left running when this scope ends)
+			Watch<milliseconds>		watch1(Schedule("* * * * *"),	true,	[]() {cout << "#1\tWatch<milliseconds>\t[sync]\t(\"* * * * *\")\tis done!" << nendl; });
+		}
+	}
+
+	namespace precision
+	{
+		// Runs a bunch of synchronous 1ms timers and returns how late each of them has fired
+		template <typename... PrecisionArg>
+		std::vector<microseconds> lateness(const PrecisionArg&... precision)
+		{
+			std::vector<microseconds> result;
+			for (int i = 0; i < 200; ++i)
+			{
+				const auto deadline = steady_clock::now() + 1ms;
+				Timer<microseconds>(Time{ 1000us }, true, precision...,
+					[&]() { result.push_back(duration_cast<microseconds>(steady_clock::now() - deadline)); });
+			}
+			std::sort(result.begin(), result.end());
+			return result;
+		}
+
+		void print(const char* name, const std::vector<microseconds>& sorted)
+		{
+			const auto percentile = [&sorted](std::size_t p) { return sorted[(sorted.size() - 1) * p / 100].count(); };
+			cout << name << "\tp50 = " << percentile(50) << "us\tp90 = " << percentile(90)
+				 << "us\tp99 = " << percentile(99) << "us\tmax = " << sorted.back().count() << "us" << nendl;
+		}
+
+		void run()
+		{
+			std::cout << nendl << "--------------Testing Timer precision--------------" << nendl;
+
+			print("sleep_for:", lateness());
+			print("precise:", lateness(Precision{}));
+			cout << "adapted slack:\t" << duration_cast<microseconds>(PreciseSleeper::slack()).count() << "us" << nendl;
+
+			try
+			{
+				Timer<microseconds>		pinned(Time{ 1000us },	true,	Precision{}.pin_to(0),	[]() {});
+			}
+			catch (const std::invalid_argument& e)
+			{
+				cout << "sync Timer(Precision{}.pin_to(0)) throws: " << e.what() << nendl;
+			}
+
+			try
+			{
+				Timer<microseconds>		timer1(Time{ 500us },	false,	Precision{}.pin_to(0),	[]() {cout << "#1\tTimer<microseconds>\t[async, precise, core #0]\t(500us)\tis done!" << nendl; });
+				Timer<microseconds>		timer2(Time{ 50000us },	true,	Precision{},			[]() {cout << "#2\tTimer<microseconds>\t[sync, precise]\t\t(50000us)\tis done!" << nendl; });
+			}
+			catch (const std::runtime_error& e)
+			{
+				cout << e.what() << nendl;
+			}
+		}
+	}
+
+	namespace store
+	{
+		void run()
+		{
+			std::cout << nendl << "--------------Testing PersistentTimers class--------------" << nendl;
+
+			const auto path = (std::filesystem::temp_directory_path() / "vartime_timers.bin").string();
+			std::filesystem::remove(path);
+
+			constexpr std::uint64_t count = 1'000'000;
+			const auto current = system_clock::now();
+
+			// "previous run": 1M timers in the future and a few that will be missed
+			{
+				TimerStore<> store(path, count);
+				for (std::uint64_t i = 0; i < count; ++i)
+					store.add(current + 1h + milliseconds(i), i % 4, i);
+				store.add(current - 10s, 4, 0);
+				store.add(current - 2h, 4, 0);
+				cout << "stored timers:\t\t" << store.size() << nendl;
+			}
+
+			// "restart"
+			{
+				std::size_t missed = 0;
+				const auto started = steady_clock::now();
+				PersistentTimers<> timers(path, [&missed](std::uint64_t callback_id, const std::uint64_t&) { missed += callback_id == 4; },
+										  count, MissedPolicy::fire_if_recent, 1min);
+				const auto armed = steady_clock::now();
+
+				cout << "restart-to-armed:\t" << duration_cast<milliseconds>(armed - started).count() << "ms" << nendl;
+				cout << "armed timers:\t\t" << timers.size() << " (the one missed by 2h is discarded)" << nendl;
+				cout << "fired by now:\t\t" << timers.fire_due() << " (missed ones fired: " << missed << ")" << nendl;
+				cout << "next fire in:\t\t" << duration_cast<minutes>(timers.next_fire() - system_clock::now()).count() << "min" << nendl;
+				cout << "fired in 1h 1ms:\t" << timers.fire_due(current + 1h + 1ms) << nendl;
+			}
+
+			// the file has to be unmapped before it can be removed (on Windows, at least)
+			std::filesystem::remove(path);
+		}
+	}
 }
 
 int main()
@@ -129,5 +304,8 @@ int main()
 	tests::time::run();
 	tests::timer::run();
 	tests::watch::run();
+	tests::schedule::run();
+	tests::precision::run();
+	tests::store::run();
 	std::cout << "END" << std::endl;
 }